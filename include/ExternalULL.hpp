@@ -0,0 +1,481 @@
+#ifndef UNROLLED_LINKED_LIST_EXTERNALULL_HPP
+#define UNROLLED_LINKED_LIST_EXTERNALULL_HPP
+// ------------------------------------------------------------------------
+/*
+ * External-memory variant of ULL. Every node is a page-sized block in a file and only a
+ * bounded number of nodes is kept in memory. The order of the nodes and their sizes are
+ * kept in an in-memory directory, so locating an element costs no I/O and only the nodes
+ * that are actually read or modified are faulted in.
+ */
+// ------------------------------------------------------------------------
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <fcntl.h>
+#include <list>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+// ------------------------------------------------------------------------
+template <class V, size_t PAGE_SIZE = 4096, size_t BLOCK_SIZE = PAGE_SIZE / sizeof(V) - 1>
+class ExternalULL {
+   static_assert(std::is_trivially_copyable_v<V>, "Nodes are written to the file byte by byte");
+   static_assert(sizeof(V) * (BLOCK_SIZE + 1) <= PAGE_SIZE, "A node has to fit into a page");
+
+   /// The part of a page that holds the elements. The node sizes live in the directory.
+   struct Node {
+      V data[BLOCK_SIZE + 1];
+   };
+
+   /// A node that is held in memory.
+   struct Frame {
+      size_t page;
+      bool dirty;
+      Node node; // Left uninitialized, it is read from the file or filled by the caller
+
+      Frame(size_t page, bool dirty) : page(page), dirty(dirty) {}
+   };
+
+   struct Entry {
+      size_t page;
+      size_t size;
+   };
+
+   public:
+   struct Location {
+      size_t k; // Position of the node in the list
+      size_t i;
+      Location(size_t k, size_t i) : k(k), i(i) {}
+   };
+
+   struct IoStats {
+      size_t reads = 0; // Pages read from the file
+      size_t writes = 0; // Dirty pages written back to the file
+      size_t hits = 0; // Node accesses served by the cache
+      size_t misses = 0; // Node accesses that had to fault the node in
+
+      IoStats& operator+=(const IoStats& other) {
+         reads += other.reads;
+         writes += other.writes;
+         hits += other.hits;
+         misses += other.misses;
+         return *this;
+      }
+   };
+
+   size_t length = 0;
+   size_t node_count = 0;
+
+   /// I/O of the most recent operation.
+   IoStats last_io;
+   /// I/O of all operations so far.
+   IoStats total_io;
+   /// Largest number of nodes held in memory at once so far.
+   size_t peak_cached_nodes = 0;
+
+   /// Returns the size of a node.
+   size_t get_node_size() { return BLOCK_SIZE + 1; }
+
+   /// Returns the BLOCK_SIZE
+   size_t get_block_size() { return BLOCK_SIZE; }
+
+   /// Returns the size of a page in the file.
+   size_t get_page_size() { return PAGE_SIZE; }
+
+   /// Returns true if the list is empty.
+   bool is_empty() { return length == 0; }
+
+   /// Creates an empty list backed by the file at path, which is truncated. At most
+   /// cache_capacity nodes are kept in memory at any time. Shifting elements between
+   /// neighbours needs both of them in memory, so cache_capacity has to be at least 2,
+   /// otherwise std::invalid_argument is thrown.
+   ExternalULL(const std::string& path, size_t cache_capacity);
+   ~ExternalULL();
+
+   ExternalULL(const ExternalULL&) = delete;
+   ExternalULL& operator=(const ExternalULL&) = delete;
+
+   /// Finds value at position i. Returns Location of value. Does not perform any I/O.
+   Location find_at(size_t i);
+
+   /// Gets a copy of the value at position i or nothing if position is out of range.
+   std::optional<V> get(size_t i);
+
+   /// Overwrites the value at position i. No bounds checking is performed.
+   void set(size_t i, const V& value);
+
+   /// Inserts a value at position i into the list.
+   template <class... Args>
+   void insert_at(size_t i, Args&&... args);
+
+   /// Appends a value at the end of the list.
+   template <class... Args>
+   void append(Args&&... args) {
+      return insert_at(length, std::forward<Args>(args)...);
+   }
+
+   /// Prepends a value at the front of the list.
+   template <class... Args>
+   void prepend(Args&&... args) {
+      return insert_at(0, std::forward<Args>(args)...);
+   }
+
+   /// Removes an element at position i.
+   void remove_at(size_t i);
+
+   /// Removes the last element of the list.
+   void pop_back() { remove_at(length - 1); }
+
+   /// Removes the first element of the list.
+   void pop_front() { remove_at(0); }
+
+   /// Writes all dirty nodes back to the file.
+   void flush();
+
+   private:
+   int fd;
+   size_t cache_capacity;
+   /// Pages in list order.
+   std::vector<Entry> directory;
+   /// Pages of removed nodes, which are reused before the file grows.
+   std::vector<size_t> free_pages;
+   size_t page_count = 0;
+
+   /// Cached nodes, most recently used first. Only the least recently used frame is evicted
+   /// to make room, so a pointer returned by data stays valid across the next call to data,
+   /// which is all that moving elements between two neighbours needs.
+   std::list<Frame> frames;
+   std::unordered_map<size_t, typename std::list<Frame>::iterator> cached;
+
+   /// Starts accounting I/O for a new operation.
+   void begin_op() { last_io = IoStats(); }
+
+   /// Finishes accounting I/O for the operation.
+   void end_op() { total_io += last_io; }
+
+   /// Returns the elements of the k-th node, faulting it in if necessary.
+   V* data(size_t k, bool dirty);
+
+   /// Adds a frame for page at the front of the cache, evicting a node first if it is full.
+   Frame& add_frame(size_t page, bool dirty);
+
+   /// Inserts an empty node at position k.
+   void add_node(size_t k);
+
+   /// Removes the (empty) node at position k.
+   void remove_node(size_t k);
+
+   /// Writes back and drops the least recently used node.
+   void evict();
+
+   void read_page(Frame& frame);
+   void write_page(Frame& frame);
+
+   /// Moves the last element of node k to the front of node k + 1.
+   void shift_r(size_t k);
+
+   /// Moves the first element of node k + 1 to the end of node k.
+   void shift_l(size_t k);
+
+   /// See ULL::spread.
+   void spread(size_t u, size_t v);
+
+   /// See ULL::gather.
+   void gather(size_t u);
+};
+// ------------------------------------------------------------------------
+template <class V, size_t PAGE_SIZE, size_t BLOCK_SIZE>
+ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::ExternalULL(const std::string& path, size_t cache_capacity)
+   : cache_capacity(cache_capacity) {
+   if (cache_capacity < 2) throw std::invalid_argument("The cache has to hold at least 2 nodes");
+
+   fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+   if (fd < 0) throw std::system_error(errno, std::generic_category(), "Cannot open " + path);
+}
+// ------------------------------------------------------------------------
+template <class V, size_t PAGE_SIZE, size_t BLOCK_SIZE>
+ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::~ExternalULL() {
+   ::close(fd);
+}
+// ------------------------------------------------------------------------
+template <class V, size_t PAGE_SIZE, size_t BLOCK_SIZE>
+class ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::Location ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::find_at(size_t i) {
+   if (i < length / 2) { // Start at front of list and search forwards
+      size_t k = 0;
+      while (i >= directory[k].size) {
+         i -= directory[k].size;
+         ++k;
+      }
+      return Location(k, i);
+   } else { // Start at back of list and search backwards
+      size_t k = directory.size();
+      size_t n = length;
+      while (i < n) {
+         --k;
+         n -= directory[k].size;
+      }
+      return Location(k, i - n);
+   }
+}
+// ------------------------------------------------------------------------
+template <class V, size_t PAGE_SIZE, size_t BLOCK_SIZE>
+std::optional<V> ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::get(size_t i) {
+   if (i >= length) return std::nullopt;
+
+   begin_op();
+   Location l = find_at(i);
+   V value = data(l.k, false)[l.i];
+   end_op();
+   return value;
+}
+// ------------------------------------------------------------------------
+template <class V, size_t PAGE_SIZE, size_t BLOCK_SIZE>
+void ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::set(size_t i, const V& value) {
+   assert(i < length);
+
+   begin_op();
+   Location l = find_at(i);
+   data(l.k, true)[l.i] = value;
+   end_op();
+}
+// ------------------------------------------------------------------------
+template <class V, size_t PAGE_SIZE, size_t BLOCK_SIZE>
+template <class... Args>
+void ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::insert_at(size_t i, Args&&... args) {
+   assert(i <= length);
+
+   begin_op();
+   if (directory.empty()) add_node(0);
+
+   Location l(directory.size() - 1, directory.back().size);
+   if (i == length) { // Inserting at end of list
+      if (directory[l.k].size == BLOCK_SIZE + 1) {
+         add_node(++l.k);
+         l.i = 0;
+      }
+   } else { // Inserting not at end of list
+      l = find_at(i);
+      size_t r = 0;
+      size_t k = l.k;
+      while (k < directory.size() && r < BLOCK_SIZE && directory[k].size == BLOCK_SIZE + 1) {
+         ++k;
+         ++r;
+      }
+
+      if (k == directory.size()) { // case 2
+         add_node(k);
+         k = k - 1;
+      } else if (r == BLOCK_SIZE) { // case 3
+         k = k - 1;
+         add_node(k + 1);
+         spread(l.k, k);
+      } else if (l.k != k) { // case 1
+         k = k - 1;
+      }
+
+      while (l.k != k) {
+         shift_r(k);
+         --k;
+      }
+      if (directory[l.k].size == BLOCK_SIZE + 1) shift_r(l.k);
+   }
+
+   V* d = data(l.k, true);
+   size_t& size = directory[l.k].size;
+   std::copy_backward(d + l.i, d + size, d + size + 1);
+   d[l.i] = V(std::forward<Args>(args)...);
+   ++size;
+   ++length;
+   end_op();
+}
+// ------------------------------------------------------------------------
+template <class V, size_t PAGE_SIZE, size_t BLOCK_SIZE>
+void ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::remove_at(size_t i) {
+   assert(i < length);
+
+   begin_op();
+   Location l = find_at(i);
+
+   size_t r = 0;
+   size_t k = l.k;
+   while (k < directory.size() && r < BLOCK_SIZE && directory[k].size == BLOCK_SIZE - 1) {
+      ++k;
+      ++r;
+   }
+
+   if (r == BLOCK_SIZE && k < directory.size()) {
+      gather(l.k);
+   }
+
+   k = l.k;
+   V* d = data(k, true);
+   std::copy(d + l.i + 1, d + directory[k].size, d + l.i);
+   --directory[k].size;
+
+   while (k + 1 < directory.size() && directory[k].size < BLOCK_SIZE - 1) {
+      shift_l(k);
+      ++k;
+   }
+
+   if (directory[k].size == 0) {
+      remove_node(k);
+   }
+
+   --length;
+   end_op();
+}
+// ------------------------------------------------------------------------
+template <class V, size_t PAGE_SIZE, size_t BLOCK_SIZE>
+void ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::flush() {
+   begin_op();
+   for (Frame& frame : frames) {
+      if (frame.dirty) write_page(frame);
+   }
+   end_op();
+}
+// ------------------------------------------------------------------------
+template <class V, size_t PAGE_SIZE, size_t BLOCK_SIZE>
+V* ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::data(size_t k, bool dirty) {
+   size_t page = directory[k].page;
+   auto it = cached.find(page);
+   if (it != cached.end()) {
+      ++last_io.hits;
+      frames.splice(frames.begin(), frames, it->second);
+   } else {
+      ++last_io.misses;
+      read_page(add_frame(page, false));
+   }
+
+   Frame& frame = frames.front();
+   frame.dirty |= dirty;
+   return frame.node.data;
+}
+// ------------------------------------------------------------------------
+template <class V, size_t PAGE_SIZE, size_t BLOCK_SIZE>
+class ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::Frame& ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::add_frame(size_t page, bool dirty) {
+   if (frames.size() == cache_capacity) evict();
+
+   frames.emplace_front(page, dirty);
+   cached.emplace(page, frames.begin());
+   peak_cached_nodes = std::max(peak_cached_nodes, frames.size());
+   return frames.front();
+}
+// ------------------------------------------------------------------------
+template <class V, size_t PAGE_SIZE, size_t BLOCK_SIZE>
+void ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::add_node(size_t k) {
+   size_t page;
+   if (free_pages.empty()) {
+      page = page_count++;
+   } else {
+      page = free_pages.back();
+      free_pages.pop_back();
+   }
+
+   // A new node has no content on disk yet, so it is created in the cache without reading it
+   add_frame(page, true);
+
+   directory.insert(directory.begin() + k, Entry{page, 0});
+   ++node_count;
+}
+// ------------------------------------------------------------------------
+template <class V, size_t PAGE_SIZE, size_t BLOCK_SIZE>
+void ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::remove_node(size_t k) {
+   size_t page = directory[k].page;
+
+   // The content of a removed node is never needed again, so it is dropped without writing it back
+   auto it = cached.find(page);
+   if (it != cached.end()) {
+      frames.erase(it->second);
+      cached.erase(it);
+   }
+
+   free_pages.push_back(page);
+   directory.erase(directory.begin() + k);
+   --node_count;
+}
+// ------------------------------------------------------------------------
+template <class V, size_t PAGE_SIZE, size_t BLOCK_SIZE>
+void ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::evict() {
+   Frame& frame = frames.back();
+   if (frame.dirty) write_page(frame);
+   cached.erase(frame.page);
+   frames.pop_back();
+}
+// ------------------------------------------------------------------------
+template <class V, size_t PAGE_SIZE, size_t BLOCK_SIZE>
+void ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::read_page(Frame& frame) {
+   ssize_t n = ::pread(fd, &frame.node, sizeof(Node), static_cast<off_t>(frame.page * PAGE_SIZE));
+   if (n != sizeof(Node)) throw std::system_error(n < 0 ? errno : EIO, std::generic_category(), "Cannot read page");
+   ++last_io.reads;
+}
+// ------------------------------------------------------------------------
+template <class V, size_t PAGE_SIZE, size_t BLOCK_SIZE>
+void ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::write_page(Frame& frame) {
+   ssize_t n = ::pwrite(fd, &frame.node, sizeof(Node), static_cast<off_t>(frame.page * PAGE_SIZE));
+   if (n != sizeof(Node)) throw std::system_error(n < 0 ? errno : EIO, std::generic_category(), "Cannot write page");
+   frame.dirty = false;
+   ++last_io.writes;
+}
+// ------------------------------------------------------------------------
+template <class V, size_t PAGE_SIZE, size_t BLOCK_SIZE>
+void ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::shift_r(size_t k) {
+   V* u = data(k, true);
+   V* v = data(k + 1, true);
+   size_t& u_size = directory[k].size;
+   size_t& v_size = directory[k + 1].size;
+
+   std::copy_backward(v, v + v_size, v + v_size + 1);
+   v[0] = u[u_size - 1];
+   ++v_size;
+   --u_size;
+}
+// ------------------------------------------------------------------------
+template <class V, size_t PAGE_SIZE, size_t BLOCK_SIZE>
+void ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::shift_l(size_t k) {
+   V* u = data(k, true);
+   V* v = data(k + 1, true);
+   size_t& u_size = directory[k].size;
+   size_t& v_size = directory[k + 1].size;
+
+   u[u_size] = v[0];
+   std::copy(v + 1, v + v_size, v);
+   --v_size;
+   ++u_size;
+}
+// ------------------------------------------------------------------------
+template <class V, size_t PAGE_SIZE, size_t BLOCK_SIZE>
+void ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::spread(size_t u, size_t v) {
+   // Bulk copy the first BLOCK_SIZE - 1 elements from v to (the empty) v + 1 in order to save on shifting
+   V* from = data(v, true);
+   V* to = data(v + 1, true);
+   size_t offset = directory[v].size - BLOCK_SIZE + 1;
+   std::copy(from + offset, from + offset + BLOCK_SIZE - 1, to);
+   directory[v].size -= BLOCK_SIZE - 1;
+   directory[v + 1].size = BLOCK_SIZE - 1;
+
+   while (--v != u) {
+      while (directory[v + 1].size < BLOCK_SIZE) {
+         shift_r(v);
+      }
+   }
+}
+// ------------------------------------------------------------------------
+template <class V, size_t PAGE_SIZE, size_t BLOCK_SIZE>
+void ExternalULL<V, PAGE_SIZE, BLOCK_SIZE>::gather(size_t u) {
+   for (size_t i = 0; i < BLOCK_SIZE - 1; ++i) {
+      while (directory[u].size < BLOCK_SIZE) {
+         shift_l(u);
+      }
+      ++u;
+   }
+
+   remove_node(u);
+}
+// ------------------------------------------------------------------------
+#endif //UNROLLED_LINKED_LIST_EXTERNALULL_HPP
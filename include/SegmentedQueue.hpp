@@ -0,0 +1,273 @@
+#ifndef UNROLLED_LINKED_LIST_SEGMENTEDQUEUE_HPP
+#define UNROLLED_LINKED_LIST_SEGMENTEDQUEUE_HPP
+// ------------------------------------------------------------------------
+/*
+ * Lock-free FIFO queue built from ULL-style nodes. Producers fill the tail node front to
+ * back, the consumer drains the head node front to back, and a drained node is recycled.
+ * A single producer takes drained nodes from a free list. With multiple producers, the
+ * consumer links a drained node behind the tail once no producer is inside it anymore.
+ * Elements are never shifted, so enqueue and dequeue are O(1).
+ */
+// ------------------------------------------------------------------------
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+// ------------------------------------------------------------------------
+enum class Producers { Single, Multi };
+// ------------------------------------------------------------------------
+template <class V, size_t BLOCK_SIZE = 63, Producers PRODUCERS = Producers::Single>
+class SegmentedQueue {
+   static constexpr bool MULTI = PRODUCERS == Producers::Multi;
+
+   struct Empty {};
+
+   class Node {
+      friend class SegmentedQueue;
+
+      V data[BLOCK_SIZE + 1];
+      std::atomic<Node*> next = nullptr;
+      /// Single producer: number of published slots. Multi producer: number of claimed slots.
+      alignas(64) std::atomic<size_t> write = 0;
+      /// Multi producer only: number of producers that may still access the node. Survives
+      /// reset, since a producer that loaded the node as tail long ago may still touch it.
+      std::atomic<size_t> producers = 0;
+      /// Multi producer only: marks the slots that have been published.
+      [[no_unique_address]] std::conditional_t<MULTI, std::array<std::atomic<bool>, BLOCK_SIZE + 1>, Empty> ready;
+      /// Number of consumed slots, only accessed by the consumer.
+      alignas(64) size_t read = 0;
+
+      /// Prepares a drained node for reuse.
+      void reset();
+   };
+
+   public:
+   SegmentedQueue();
+   ~SegmentedQueue();
+
+   SegmentedQueue(const SegmentedQueue&) = delete;
+   SegmentedQueue& operator=(const SegmentedQueue&) = delete;
+
+   /// Returns the size of a node.
+   size_t get_node_size() { return BLOCK_SIZE + 1; }
+
+   /// Returns the BLOCK_SIZE
+   size_t get_block_size() { return BLOCK_SIZE; }
+
+   /// Appends a value at the end of the queue. With Producers::Single only one thread may enqueue.
+   template <class... Args>
+   void enqueue(Args&&... args);
+
+   /// Moves the first value of the queue into out. Returns false if the queue is empty.
+   /// Only one thread may dequeue. With Producers::Multi an element whose producer is still
+   /// writing it holds back the elements behind it.
+   bool try_dequeue(V& out);
+
+   /// Returns the number of drained nodes that wait for producers to leave them before they
+   /// are recycled. Only the consumer may call it.
+   size_t pending_nodes() { return retired.size(); }
+
+   private:
+   /// Node the consumer drains, only accessed by the consumer.
+   alignas(64) Node* head;
+   /// Multi producer only: drained nodes a producer might still look at, only accessed by the consumer.
+   std::vector<Node*> retired;
+   /// Multi producer only: recycled nodes not linked behind the tail yet, only accessed by the consumer.
+   std::vector<Node*> spare;
+   /// Node the producers fill.
+   alignas(64) std::atomic<Node*> tail;
+   /// Single producer only: nodes taken off the free list, only accessed by the producer.
+   Node* stash = nullptr;
+   /// Single producer only: drained nodes, linked through next.
+   alignas(64) std::atomic<Node*> free_list = nullptr;
+
+   /// Multi producer only: returns the tail node after registering the calling producer in it.
+   Node* enter_tail();
+
+   /// Returns whether slot i of u holds a value.
+   bool is_published(Node* u, size_t i);
+
+   /// Single producer only: takes a node from the free list or allocates a new one.
+   Node* acquire_node();
+
+   /// Recycles a node the consumer has drained.
+   void retire(Node* u);
+};
+// ------------------------------------------------------------------------
+// Node - Begin
+// ------------------------------------------------------------------------
+template <class V, size_t BLOCK_SIZE, Producers PRODUCERS>
+void SegmentedQueue<V, BLOCK_SIZE, PRODUCERS>::Node::reset() {
+   next.store(nullptr, std::memory_order_relaxed);
+   write.store(0, std::memory_order_relaxed);
+   if constexpr (MULTI) {
+      for (auto& flag : ready) {
+         flag.store(false, std::memory_order_relaxed);
+      }
+   }
+   read = 0;
+}
+// ------------------------------------------------------------------------
+// Node - End
+// ------------------------------------------------------------------------
+// SegmentedQueue - Begin
+template <class V, size_t BLOCK_SIZE, Producers PRODUCERS>
+SegmentedQueue<V, BLOCK_SIZE, PRODUCERS>::SegmentedQueue() {
+   head = new Node;
+   tail.store(head, std::memory_order_relaxed);
+}
+// ------------------------------------------------------------------------
+template <class V, size_t BLOCK_SIZE, Producers PRODUCERS>
+SegmentedQueue<V, BLOCK_SIZE, PRODUCERS>::~SegmentedQueue() {
+   for (Node* first : {head, stash, free_list.load()}) {
+      Node* current = first;
+      Node* next;
+      while (current) {
+         next = current->next.load(std::memory_order_relaxed);
+         delete current;
+         current = next;
+      }
+   }
+   for (Node* u : retired) {
+      delete u;
+   }
+   for (Node* u : spare) {
+      delete u;
+   }
+}
+// ------------------------------------------------------------------------
+template <class V, size_t BLOCK_SIZE, Producers PRODUCERS>
+template <class... Args>
+void SegmentedQueue<V, BLOCK_SIZE, PRODUCERS>::enqueue(Args&&... args) {
+   if constexpr (!MULTI) {
+      Node* t = tail.load(std::memory_order_relaxed);
+      size_t w = t->write.load(std::memory_order_relaxed);
+      if (w == BLOCK_SIZE + 1) {
+         Node* u = acquire_node();
+         t->next.store(u, std::memory_order_release);
+         tail.store(u, std::memory_order_relaxed);
+         t = u;
+         w = 0;
+      }
+      t->data[w] = V(std::forward<Args>(args)...);
+      t->write.store(w + 1, std::memory_order_release);
+   } else {
+      while (true) {
+         Node* t = enter_tail();
+         size_t w = t->write.fetch_add(1, std::memory_order_relaxed);
+         if (w < BLOCK_SIZE + 1) {
+            t->data[w] = V(std::forward<Args>(args)...);
+            t->ready[w].store(true, std::memory_order_release);
+            t->producers.fetch_sub(1, std::memory_order_release);
+            break;
+         }
+
+         // The tail node is full, link a new one unless another producer or the consumer already did
+         Node* u = t->next.load(std::memory_order_acquire);
+         if (u == nullptr) {
+            Node* fresh = new Node;
+            if (t->next.compare_exchange_strong(u, fresh, std::memory_order_acq_rel)) {
+               u = fresh;
+            } else {
+               delete fresh;
+            }
+         }
+         Node* full = t;
+         tail.compare_exchange_strong(t, u);
+         full->producers.fetch_sub(1, std::memory_order_release);
+      }
+   }
+}
+// ------------------------------------------------------------------------
+template <class V, size_t BLOCK_SIZE, Producers PRODUCERS>
+class SegmentedQueue<V, BLOCK_SIZE, PRODUCERS>::Node* SegmentedQueue<V, BLOCK_SIZE, PRODUCERS>::enter_tail() {
+   while (true) {
+      Node* t = tail.load();
+      t->producers.fetch_add(1);
+      // Either this load sees that retire moved tail past t, or retire sees the registration.
+      // Nodes are only freed by the destructor, so registering with a stale node is harmless.
+      if (tail.load() == t) return t;
+      t->producers.fetch_sub(1, std::memory_order_release);
+   }
+}
+// ------------------------------------------------------------------------
+template <class V, size_t BLOCK_SIZE, Producers PRODUCERS>
+bool SegmentedQueue<V, BLOCK_SIZE, PRODUCERS>::try_dequeue(V& out) {
+   Node* u = head;
+   if (u->read == BLOCK_SIZE + 1) {
+      Node* next = u->next.load(std::memory_order_acquire);
+      if (next == nullptr) return false;
+      head = next;
+      retire(u);
+      u = next;
+   }
+
+   if (!is_published(u, u->read)) return false;
+   out = std::move(u->data[u->read]);
+   ++u->read;
+   return true;
+}
+// ------------------------------------------------------------------------
+template <class V, size_t BLOCK_SIZE, Producers PRODUCERS>
+bool SegmentedQueue<V, BLOCK_SIZE, PRODUCERS>::is_published(Node* u, size_t i) {
+   if constexpr (MULTI) {
+      return u->ready[i].load(std::memory_order_acquire);
+   } else {
+      return i < u->write.load(std::memory_order_acquire);
+   }
+}
+// ------------------------------------------------------------------------
+template <class V, size_t BLOCK_SIZE, Producers PRODUCERS>
+class SegmentedQueue<V, BLOCK_SIZE, PRODUCERS>::Node* SegmentedQueue<V, BLOCK_SIZE, PRODUCERS>::acquire_node() {
+   // The whole list is taken at once, so that the consumer can keep pushing while the producer
+   // works through its stash
+   if (stash == nullptr) {
+      stash = free_list.exchange(nullptr, std::memory_order_acquire);
+      if (stash == nullptr) return new Node;
+   }
+
+   Node* u = stash;
+   stash = u->next.load(std::memory_order_relaxed);
+   u->next.store(nullptr, std::memory_order_relaxed);
+   return u;
+}
+// ------------------------------------------------------------------------
+template <class V, size_t BLOCK_SIZE, Producers PRODUCERS>
+void SegmentedQueue<V, BLOCK_SIZE, PRODUCERS>::retire(Node* u) {
+   if constexpr (!MULTI) {
+      // The producer does not touch a node anymore once it linked its successor
+      u->reset();
+      Node* top = free_list.load(std::memory_order_relaxed);
+      do {
+         u->next.store(top, std::memory_order_relaxed);
+      } while (!free_list.compare_exchange_weak(top, u, std::memory_order_release, std::memory_order_relaxed));
+   } else {
+      // The producer that linked the successor of u may not have moved tail yet. Once tail is
+      // past u, only producers registered in u can still access it.
+      Node* expected = u;
+      tail.compare_exchange_strong(expected, u->next.load(std::memory_order_relaxed));
+
+      retired.push_back(u);
+      auto in_use = std::partition(retired.begin(), retired.end(), [](Node* v) { return v->producers.load() != 0; });
+      for (auto it = in_use; it != retired.end(); ++it) {
+         (*it)->reset();
+         spare.push_back(*it);
+      }
+      retired.erase(in_use, retired.end());
+
+      // Hand a spare node to the producers before they fill the tail. Only the consumer recycles
+      // nodes and it never recycles the tail, so t stays valid.
+      if (!spare.empty()) {
+         Node* t = tail.load();
+         Node* expected = nullptr;
+         if (t->next.compare_exchange_strong(expected, spare.back(), std::memory_order_release, std::memory_order_relaxed)) {
+            spare.pop_back();
+         }
+      }
+   }
+}
+// ------------------------------------------------------------------------
+// SegmentedQueue - End
+#endif //UNROLLED_LINKED_LIST_SEGMENTEDQUEUE_HPP
@@ -0,0 +1,454 @@
+#ifndef UNROLLED_LINKED_LIST_TEXTBUFFER_HPP
+#define UNROLLED_LINKED_LIST_TEXTBUFFER_HPP
+// ------------------------------------------------------------------------
+/*
+ * Unrolled linked list of bytes for editor-style workloads. Unlike ULL<char>, it inserts,
+ * erases and copies whole ranges with memmove/memcpy and keeps the number of newlines
+ * per node, so that line/column lookups only scan a single node.
+ *
+ * Every node except a sole one is at least half full.
+ */
+// ------------------------------------------------------------------------
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+#include <unistd.h>
+// ------------------------------------------------------------------------
+template <size_t BLOCK_SIZE = 4096>
+class TextBuffer {
+   static_assert(BLOCK_SIZE >= 2, "Nodes have to be splittable");
+
+   class Node {
+      friend class TextBuffer;
+
+      char data[BLOCK_SIZE];
+      Node* next = nullptr;
+      Node* prev = nullptr;
+      size_t size = 0;
+      /// Number of '\n' in data.
+      size_t lines = 0;
+
+      bool is_empty() { return size == 0; }
+
+      void count_lines() { lines = std::count(data, data + size, '\n'); }
+   };
+
+   struct Location {
+      Node* u;
+      size_t i;
+      size_t lines; // Number of '\n' before u
+      Location(Node* u, size_t i, size_t lines) : u(u), i(i), lines(lines) {}
+   };
+
+   public:
+   struct LineColumn {
+      size_t line;
+      size_t column;
+   };
+
+   size_t length = 0;
+   size_t node_count = 0;
+   /// Number of '\n' in the buffer.
+   size_t newlines = 0;
+
+   /// Returns the BLOCK_SIZE
+   size_t get_block_size() { return BLOCK_SIZE; }
+
+   /// Returns true if the buffer is empty.
+   bool is_empty() { return length == 0; }
+
+   /// Returns the number of lines. An empty buffer has a single empty line.
+   size_t line_count() { return newlines + 1; }
+
+   TextBuffer() = default;
+   explicit TextBuffer(std::string_view text) { insert(0, text); }
+   ~TextBuffer();
+
+   TextBuffer(const TextBuffer&) = delete;
+   TextBuffer& operator=(const TextBuffer&) = delete;
+
+   /// Inserts text at position pos.
+   void insert(size_t pos, std::string_view text);
+
+   /// Erases up to len bytes starting at position pos.
+   void erase(size_t pos, size_t len);
+
+   /// Returns a copy of up to len bytes starting at position pos.
+   std::string substr(size_t pos, size_t len);
+
+   /// Returns the byte at position i. No bounds checking is performed.
+   char operator[](size_t i);
+
+   /// Returns the zero-based line and column of position pos.
+   LineColumn line_column(size_t pos);
+
+   /// Returns the position of the given zero-based line and column. No bounds checking is
+   /// performed on the column.
+   size_t position(size_t line, size_t column);
+
+   /// Writes the buffer to os.
+   void write_to(std::ostream& os);
+
+   /// Writes the buffer to the file descriptor fd. Returns false if writing failed.
+   bool write_to(int fd);
+
+   /// Checks the links, length, node_count and newline counts of the buffer, and that every
+   /// node but a sole one is at least half full.
+   bool check_invariants();
+
+   private:
+   /// Store the end of the list in head->prev.
+   Node* head = nullptr;
+
+   /// Finds the byte at position pos, or the end of the last node if pos is length.
+   Location find_at(size_t pos);
+
+   /// Inserts a new node after u.
+   Node* insert_after(Node* u);
+
+   /// Unlinks and deletes u.
+   void remove_node(Node* u);
+
+   /// Merges u with neighbours or moves bytes over from one until u is at least half full.
+   void rebalance(Node* u);
+};
+// ------------------------------------------------------------------------
+template <size_t BLOCK_SIZE>
+TextBuffer<BLOCK_SIZE>::~TextBuffer() {
+   Node* current = head;
+   Node* next;
+   while (current) {
+      next = current->next;
+      delete current;
+      current = next;
+   }
+}
+// ------------------------------------------------------------------------
+template <size_t BLOCK_SIZE>
+void TextBuffer<BLOCK_SIZE>::insert(size_t pos, std::string_view text) {
+   assert(pos <= length);
+
+   if (text.empty()) return;
+
+   if (head == nullptr) {
+      head = new Node;
+      head->prev = head;
+      node_count = 1;
+   }
+
+   size_t text_lines = std::count(text.begin(), text.end(), '\n');
+   Location l = find_at(pos);
+   Node* u = l.u;
+
+   if (u->size + text.size() <= BLOCK_SIZE) {
+      std::memmove(u->data + l.i + text.size(), u->data + l.i, u->size - l.i);
+      std::memcpy(u->data + l.i, text.data(), text.size());
+      u->size += text.size();
+      u->lines += text_lines;
+   } else {
+      // Spread u[0, i) + text + u[i, size) evenly onto u and as few new nodes as possible,
+      // which keeps every node at least half full
+      std::string prefix(u->data, l.i);
+      std::string suffix(u->data + l.i, u->size - l.i);
+      std::string_view pieces[] = {prefix, text, suffix};
+      size_t total = u->size + text.size();
+      size_t count = (total + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+      size_t p = 0;
+      for (size_t k = 0; k < count; ++k) {
+         if (k > 0) u = insert_after(u);
+         size_t want = total / count + (k < total % count);
+         u->size = 0;
+         while (want > 0) {
+            size_t take = std::min(want, pieces[p].size());
+            std::memcpy(u->data + u->size, pieces[p].data(), take);
+            pieces[p].remove_prefix(take);
+            u->size += take;
+            want -= take;
+            if (pieces[p].empty()) ++p;
+         }
+         u->count_lines();
+      }
+   }
+
+   length += text.size();
+   newlines += text_lines;
+}
+// ------------------------------------------------------------------------
+template <size_t BLOCK_SIZE>
+void TextBuffer<BLOCK_SIZE>::erase(size_t pos, size_t len) {
+   if (pos >= length || len == 0) return;
+   len = std::min(len, length - pos);
+
+   Location l = find_at(pos);
+   // The node before the erased range survives, so it is used to find the touched nodes afterwards
+   Node* before = l.u == head ? nullptr : l.u->prev;
+
+   Node* u = l.u;
+   size_t i = l.i;
+   length -= len;
+   while (len > 0) {
+      size_t take = std::min(len, u->size - i);
+      size_t erased_lines = std::count(u->data + i, u->data + i + take, '\n');
+      std::memmove(u->data + i, u->data + i + take, u->size - i - take);
+      u->size -= take;
+      u->lines -= erased_lines;
+      newlines -= erased_lines;
+      len -= take;
+
+      Node* next = u->next;
+      if (u->is_empty()) remove_node(u);
+      u = next;
+      i = 0;
+   }
+
+   // Only the first and the last touched node can have become less than half full
+   Node* first = before ? before->next : head;
+   if (first == nullptr) return;
+   rebalance(first);
+   first = before ? before->next : head;
+   if (first != nullptr && first->next != nullptr) rebalance(first->next);
+}
+// ------------------------------------------------------------------------
+template <size_t BLOCK_SIZE>
+std::string TextBuffer<BLOCK_SIZE>::substr(size_t pos, size_t len) {
+   if (pos >= length) return std::string();
+   len = std::min(len, length - pos);
+
+   std::string result(len, '\0');
+   Location l = find_at(pos);
+   Node* u = l.u;
+   size_t i = l.i;
+   for (size_t copied = 0; copied < len; u = u->next, i = 0) {
+      size_t take = std::min(len - copied, u->size - i);
+      std::memcpy(result.data() + copied, u->data + i, take);
+      copied += take;
+   }
+   return result;
+}
+// ------------------------------------------------------------------------
+template <size_t BLOCK_SIZE>
+char TextBuffer<BLOCK_SIZE>::operator[](size_t i) {
+   assert(i < length);
+
+   Location l = find_at(i);
+   return l.u->data[l.i];
+}
+// ------------------------------------------------------------------------
+template <size_t BLOCK_SIZE>
+class TextBuffer<BLOCK_SIZE>::LineColumn TextBuffer<BLOCK_SIZE>::line_column(size_t pos) {
+   assert(pos <= length);
+
+   if (head == nullptr) return {0, 0};
+
+   Location l = find_at(pos);
+   size_t before = std::count(l.u->data, l.u->data + l.i, '\n');
+   size_t line = l.lines + before;
+   if (line == 0) return {0, pos};
+
+   // The column is the distance to the previous '\n'. Nodes without one are skipped by their
+   // counts, so only the node that holds it is searched.
+   Node* u = l.u;
+   size_t end = l.i;
+   size_t column = 0;
+   if (before == 0) {
+      column = l.i;
+      u = u->prev;
+      while (u->lines == 0) {
+         column += u->size;
+         u = u->prev;
+      }
+      end = u->size;
+   }
+   // A reverse std::find instead of memrchr, which is a glibc extension
+   auto found = std::find(std::make_reverse_iterator(u->data + end), std::make_reverse_iterator(u->data), '\n');
+   column += u->data + end - found.base();
+   return {line, column};
+}
+// ------------------------------------------------------------------------
+template <size_t BLOCK_SIZE>
+size_t TextBuffer<BLOCK_SIZE>::position(size_t line, size_t column) {
+   assert(line <= newlines);
+
+   if (line == 0) return column;
+
+   // Find the node holding the line-th '\n'
+   Node* u = head;
+   size_t start = 0;
+   while (line > u->lines) {
+      line -= u->lines;
+      start += u->size;
+      u = u->next;
+   }
+
+   const char* c = u->data;
+   for (; line > 0; ++c) {
+      c = static_cast<const char*>(std::memchr(c, '\n', u->data + u->size - c));
+      --line;
+   }
+   return start + (c - u->data) + column;
+}
+// ------------------------------------------------------------------------
+template <size_t BLOCK_SIZE>
+void TextBuffer<BLOCK_SIZE>::write_to(std::ostream& os) {
+   for (Node* u = head; u != nullptr; u = u->next) {
+      os.write(u->data, static_cast<std::streamsize>(u->size));
+   }
+}
+// ------------------------------------------------------------------------
+template <size_t BLOCK_SIZE>
+bool TextBuffer<BLOCK_SIZE>::write_to(int fd) {
+   // Hand batches of nodes to a single writev to save on system calls
+   constexpr int BATCH = 64;
+   iovec iov[BATCH];
+
+   Node* u = head;
+   while (u != nullptr) {
+      int n = 0;
+      for (; u != nullptr && n < BATCH; u = u->next, ++n) {
+         iov[n].iov_base = u->data;
+         iov[n].iov_len = u->size;
+      }
+
+      iovec* first = iov;
+      while (n > 0) {
+         ssize_t written = ::writev(fd, first, n);
+         if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+         }
+         while (n > 0 && static_cast<size_t>(written) >= first->iov_len) {
+            written -= static_cast<ssize_t>(first->iov_len);
+            ++first;
+            --n;
+         }
+         if (n > 0) {
+            first->iov_base = static_cast<char*>(first->iov_base) + written;
+            first->iov_len -= written;
+         }
+      }
+   }
+   return true;
+}
+// ------------------------------------------------------------------------
+template <size_t BLOCK_SIZE>
+bool TextBuffer<BLOCK_SIZE>::check_invariants() {
+   if (head == nullptr) return length == 0 && node_count == 0 && newlines == 0;
+
+   size_t nodes = 0;
+   size_t bytes = 0;
+   size_t lines = 0;
+   Node* last = nullptr;
+   for (Node* u = head; u != nullptr; u = u->next) {
+      if (u != head && u->prev != last) return false;
+      if (u->size > BLOCK_SIZE) return false;
+      if (node_count > 1 && u->size < BLOCK_SIZE / 2) return false;
+      if (u->lines != static_cast<size_t>(std::count(u->data, u->data + u->size, '\n'))) return false;
+      ++nodes;
+      bytes += u->size;
+      lines += u->lines;
+      last = u;
+   }
+   return head->prev == last && bytes == length && nodes == node_count && lines == newlines;
+}
+// ------------------------------------------------------------------------
+template <size_t BLOCK_SIZE>
+class TextBuffer<BLOCK_SIZE>::Location TextBuffer<BLOCK_SIZE>::find_at(size_t pos) {
+   Node* u = head;
+   if (pos < length / 2) { // Start at front of list and search forwards
+      size_t lines = 0;
+      while (pos >= u->size) {
+         pos -= u->size;
+         lines += u->lines;
+         u = u->next;
+      }
+      return Location(u, pos, lines);
+   } else { // Start at back of list and search backwards
+      size_t n = length;
+      size_t lines = newlines;
+      do {
+         u = u->prev;
+         n -= u->size;
+         lines -= u->lines;
+      } while (pos < n);
+      return Location(u, pos - n, lines);
+   }
+}
+// ------------------------------------------------------------------------
+template <size_t BLOCK_SIZE>
+class TextBuffer<BLOCK_SIZE>::Node* TextBuffer<BLOCK_SIZE>::insert_after(Node* u) {
+   Node* v = new Node;
+   v->prev = u;
+   v->next = u->next;
+   if (u->next != nullptr) {
+      u->next->prev = v;
+   } else {
+      head->prev = v;
+   }
+   u->next = v;
+   ++node_count;
+   return v;
+}
+// ------------------------------------------------------------------------
+template <size_t BLOCK_SIZE>
+void TextBuffer<BLOCK_SIZE>::remove_node(Node* u) {
+   if (u == head) {
+      head = u->next;
+      if (head != nullptr) head->prev = u->prev;
+   } else {
+      u->prev->next = u->next;
+      if (u->next != nullptr) {
+         u->next->prev = u->prev;
+      } else {
+         head->prev = u->prev;
+      }
+   }
+   delete u;
+   --node_count;
+}
+// ------------------------------------------------------------------------
+template <size_t BLOCK_SIZE>
+void TextBuffer<BLOCK_SIZE>::rebalance(Node* u) {
+   // Merging two nodes that are less than half full can leave the merged node less than half
+   // full, in which case it is merged again
+   while (u->size < BLOCK_SIZE / 2 && node_count > 1) {
+      Node* a = u->next ? u : u->prev;
+      Node* b = a->next;
+      size_t total = a->size + b->size;
+
+      if (total <= BLOCK_SIZE) { // Merge b into a
+         std::memcpy(a->data + a->size, b->data, b->size);
+         a->size = total;
+         a->lines += b->lines;
+         remove_node(b);
+         u = a;
+         continue;
+      }
+
+      // Otherwise both nodes end up with more than BLOCK_SIZE / 2 bytes
+      if (a->size < b->size) { // Move the front of b to the end of a
+         size_t move = total / 2 - a->size;
+         std::memcpy(a->data + a->size, b->data, move);
+         std::memmove(b->data, b->data + move, b->size - move);
+         a->size += move;
+         b->size -= move;
+      } else { // Move the end of a to the front of b
+         size_t move = total / 2 - b->size;
+         std::memmove(b->data + move, b->data, b->size);
+         std::memcpy(b->data, a->data + a->size - move, move);
+         a->size -= move;
+         b->size += move;
+      }
+      a->count_lines();
+      b->count_lines();
+      return;
+   }
+}
+// ------------------------------------------------------------------------
+#endif //UNROLLED_LINKED_LIST_TEXTBUFFER_HPP
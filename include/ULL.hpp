@@ -6,21 +6,36 @@
  */
 // ------------------------------------------------------------------------
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 #include <iostream>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
 // ------------------------------------------------------------------------
 // TODO: Replace data[i] = data[i + 1] with std::copy
 // ------------------------------------------------------------------------
 template <class V, size_t BLOCK_SIZE = 3>
 class ULL {
+   struct Slab;
+
    class Node {
       friend class ULL;
 
-      V data[BLOCK_SIZE + 1];
+      // The header comes first, so that a traversal only touches the first cache line of a node
       Node* next = nullptr;
       Node* prev = nullptr;
       size_t size = 0;
+      /// Number of owners, i.e. the list and every snapshot holding the node. Shared nodes are immutable.
+      std::atomic<size_t> refs{1};
+      /// Whether a snapshot took the node since the list last found it to be the only owner.
+      /// Only accessed by the writer, which saves the atomic load of refs for unshared nodes.
+      bool shared = false;
+      /// The slab relayout() placed the node in, or nullptr if the node was allocated on its own.
+      Slab* slab = nullptr;
+      V data[BLOCK_SIZE + 1];
 
       template <class... Args>
       void insert_at(size_t i, Args&&... args);
@@ -42,16 +57,49 @@ class ULL {
       void remove_at(size_t i);
    };
 
+   /// Contiguous storage for the nodes placed by relayout(). Freed once all of its nodes are gone.
+   struct Slab {
+      Node* nodes;
+      size_t count;
+      std::atomic<size_t> live;
+   };
+
    struct Location {
       Node* u;
       size_t i;
       Location(Node* u, int i) : u(u), i(i) {}
    };
 
+   /// Runs a fixed number of nodes ahead of a traversal along link and prefetches the node it
+   /// lands on, so that the traversal does not stall on a cache miss at every node.
+   struct Lookahead {
+      Node* ahead = nullptr;
+      Node* Node::*link;
+      /// Last node to prefetch, since following prev wraps around from head to the end of the list.
+      Node* stop;
+
+      Lookahead(Node* u, size_t distance, Node* Node::*link, Node* stop = nullptr) : link(link), stop(stop) {
+         if (distance == 0) return;
+         ahead = u;
+         for (size_t d = 0; d < distance; ++d) {
+            step();
+         }
+      }
+
+      void step() {
+         if (ahead == nullptr) return;
+         ahead = ahead == stop ? nullptr : ahead->*link;
+         if (ahead != nullptr) prefetch(ahead);
+      }
+   };
+
    public:
    size_t length = 0;
    size_t node_count = 0;
 
+   /// Number of nodes traversals prefetch ahead. 0 disables prefetching.
+   size_t prefetch_distance = 2;
+
    /// Returns the size of a node.
    size_t get_node_size() { return BLOCK_SIZE + 1; }
 
@@ -65,10 +113,18 @@ class ULL {
    ~ULL();
 
    /// Finds value at position i. Returns Location of value.
-   Location find_at(int i);
+   Location find_at(int i) const;
 
    /// Gets a value at position i. Returns a pointer the value or nullptr if position is out of range.
    V* get(int i) {
+      if (i < 0 || i >= length) return nullptr;
+      Location l = find_at(i);
+      return &unshare(l.u)->data[l.i];
+   }
+
+   /// Gets a value at position i without unsharing its node. Returns a pointer the value or
+   /// nullptr if position is out of range.
+   const V* get(int i) const {
       if (i < 0 || i >= length) return nullptr;
       Location l = find_at(i);
       return &l.u->data[l.i];
@@ -99,75 +155,268 @@ class ULL {
    /// Removes the first element of the list.
    void pop_front() { remove_at(0); }
 
+   /// A read-only, point-in-time view of the list. The nodes are shared with the list,
+   /// which copies a shared node before it mutates it.
+   class Snapshot {
+      friend class ULL;
+
+      std::vector<Node*> nodes;
+      /// Position of the first element of each node.
+      std::vector<size_t> starts;
+
+      Location locate(size_t i) const {
+         size_t k = std::upper_bound(starts.begin(), starts.end(), i) - starts.begin() - 1;
+         return Location(nodes[k], i - starts[k]);
+      }
+
+      public:
+      size_t length = 0;
+      size_t node_count = 0;
+
+      Snapshot() = default;
+      Snapshot(const Snapshot& other);
+      Snapshot(Snapshot&& other) noexcept;
+      Snapshot& operator=(Snapshot other) noexcept;
+      ~Snapshot();
+
+      /// Returns true if the snapshot is empty.
+      bool is_empty() const { return length == 0; }
+
+      /// Gets a value at position i. Returns a pointer the value or nullptr if position is out of range.
+      const V* get(int i) const {
+         if (i < 0 || i >= length) return nullptr;
+         Location l = locate(i);
+         return &l.u->data[l.i];
+      }
+
+      /// Returns a reference to the element at specified position i. No bounds checking is performed.
+      const V& operator[](size_t i) const {
+         assert(i < length);
+
+         Location l = locate(i);
+         return l.u->data[l.i];
+      }
+
+      struct Iterator {
+         using iterator_category = std::bidirectional_iterator_tag;
+         using value_type = V;
+         using difference_type = std::ptrdiff_t;
+         using pointer = const V*;
+         using reference = const V&;
+
+         Iterator(const Snapshot& snapshot, size_t k, size_t i) : snapshot_(&snapshot), k_(k), i_(i) {}
+
+         reference operator*() const { return snapshot_->nodes[k_]->data[i_]; }
+         pointer operator->() const { return &snapshot_->nodes[k_]->data[i_]; }
+         Iterator& operator++() {
+            if (i_ == snapshot_->nodes[k_]->size - 1) {
+               ++k_;
+               i_ = 0;
+            } else {
+               ++i_;
+            }
+            return *this;
+         }
+         Iterator operator++(int) {
+            Iterator tmp = *this;
+            ++(*this);
+            return tmp;
+         }
+         Iterator& operator--() {
+            if (i_ == 0) {
+               --k_;
+               i_ = snapshot_->nodes[k_]->size - 1;
+            } else {
+               --i_;
+            }
+            return *this;
+         }
+         Iterator operator--(int) {
+            Iterator tmp = *this;
+            --(*this);
+            return tmp;
+         }
+         bool operator==(const Iterator& other) const { return k_ == other.k_ && i_ == other.i_; }
+         bool operator!=(const Iterator& other) const { return k_ != other.k_ || i_ != other.i_; }
+
+         private:
+         const Snapshot* snapshot_;
+         size_t k_;
+         size_t i_;
+      };
+
+      Iterator begin() const { return Iterator(*this, 0, 0); }
+      Iterator end() const { return Iterator(*this, nodes.size(), 0); }
+   };
+
+   /// Takes a read-only snapshot of the list in O(node_count) without copying any element.
+   /// Must be called by the writer; the snapshot itself may be read and destroyed on any thread.
+   Snapshot snapshot();
+
    /// Prints the list to cout.
    void print_list();
 
+   /// Moves all nodes into a single allocation in list order, so that traversals read memory
+   /// sequentially and the hardware prefetcher can help. Nodes created by later insertions are
+   /// allocated on their own again.
+   void relayout();
+
+   /// Checks the links, length and node_count of the list, and that every node but the last
+   /// holds between BLOCK_SIZE - 1 and BLOCK_SIZE + 1 elements.
+   bool check_invariants();
+
    /// Returns a reference to the element at specified position i. No bounds checking is performed.
    V& operator[](size_t i);
 
-   struct Iterator {
+   /// Returns a reference to the element at specified position i without unsharing its node.
+   /// No bounds checking is performed.
+   const V& operator[](size_t i) const;
+
+   /// Iterator over the list, or over a const list if CONST. Besides its node, it tracks its
+   /// position, so that it finds its node again once an element assignment elsewhere replaced
+   /// that node by a private copy (see unshare). A non-const iterator unshares every node it
+   /// lands on, so that writing through it never reaches a snapshot.
+   template <bool CONST>
+   struct BasicIterator {
+      using List = std::conditional_t<CONST, const ULL<V, BLOCK_SIZE>, ULL<V, BLOCK_SIZE>>;
       using iterator_category = std::bidirectional_iterator_tag;
       using value_type = V;
       using difference_type = std::ptrdiff_t;
-      using pointer = V*;
-      using reference = V&;
+      using pointer = std::conditional_t<CONST, const V*, V*>;
+      using reference = std::conditional_t<CONST, const V&, V&>;
 
-      Iterator(Node* node, size_t i, ULL<V, BLOCK_SIZE>& ull) : node_(node), i_(i), ull_(ull) {}
+      BasicIterator(Node* node, size_t i, size_t start, List& ull)
+         : node_(node), i_(i), start_(start), epoch_(ull.epoch), ull_(ull), lookahead_(node, ull.prefetch_distance, &Node::next) {
+         land();
+      }
 
-      reference operator*() const { return node_->data[i_]; }
-      pointer operator->() const { return &node_->data[i_]; }
+      /// Converts an iterator into a const iterator.
+      operator BasicIterator<true>() const {
+         sync();
+         return BasicIterator<true>(node_, i_, start_, ull_);
+      }
+
+      reference operator*() const {
+         sync();
+         return node_->data[i_];
+      }
+      pointer operator->() const {
+         sync();
+         return &node_->data[i_];
+      }
       reference operator[](size_t i) const { // Not needed for bidirectional iterator
          auto l = ull_.find_at(i);
-         return l.u->data[l.i];
+         if constexpr (CONST) {
+            return l.u->data[l.i];
+         } else {
+            return ull_.unshare(l.u)->data[l.i];
+         }
       }
-      Iterator& operator++() {
-         if (i_ == node_->size - 1) {
+      BasicIterator& operator++() {
+         sync();
+         if (++i_ == node_->size) {
+            start_ += i_;
             node_ = node_->next;
             i_ = 0;
-         } else {
-            ++i_;
+            lookahead_.step();
+            land();
          }
          return *this;
       }
-      Iterator operator++(int) {
-         Iterator tmp = *this;
+      BasicIterator operator++(int) {
+         BasicIterator tmp = *this;
          ++(*this);
          return tmp;
       }
-      Iterator& operator--() {
+      BasicIterator& operator--() {
+         sync();
          if (i_ == 0) {
             if (node_ == ull_.head) {
                node_ = nullptr; // Needed because end of list is stored in head.prev
             } else {
                node_ = node_->prev;
                i_ = node_->size - 1;
+               start_ -= node_->size;
+               land();
             }
          } else {
             --i_;
          }
          return *this;
       }
-      Iterator operator--(int) {
-         Iterator tmp = *this;
+      BasicIterator operator--(int) {
+         BasicIterator tmp = *this;
          --(*this);
          return tmp;
       }
-      bool operator==(const Iterator& other) const { return node_ == other.node_ && i_ == other.i_; }
-      bool operator!=(const Iterator& other) const { return node_ != other.node_ || i_ != other.i_; }
+      /// Iterators without a node are the end of the list, all others are compared by position,
+      /// which stays valid while their nodes are replaced.
+      bool operator==(const BasicIterator& other) const {
+         if (node_ == nullptr || other.node_ == nullptr) return node_ == other.node_;
+         return start_ + i_ == other.start_ + other.i_;
+      }
+      bool operator!=(const BasicIterator& other) const { return !(*this == other); }
 
       private:
-      Node* node_;
-      size_t i_;
-      ULL<V, BLOCK_SIZE>& ull_; // Needed to identify the end of list in head.prev
+      // Updated by sync, which is called from const members
+      mutable Node* node_;
+      mutable size_t i_;
+      /// Position of the first element of node_.
+      mutable size_t start_;
+      /// Value of ull_.epoch when node_ was last known to be in the list and, unless CONST,
+      /// not shared with a snapshot.
+      mutable size_t epoch_;
+      List& ull_; // Needed to identify the end of list in head.prev
+      mutable Lookahead lookahead_;
+
+      /// Unshares the node the iterator just moved to unless CONST. Checking the list first
+      /// keeps traversals from waiting for the node to arrive from memory.
+      void land() const {
+         if constexpr (!CONST) {
+            if (node_ == nullptr || ull_.shared_nodes == 0 || !node_->shared) return;
+            node_ = ull_.unshare(node_);
+            epoch_ = ull_.epoch;
+         }
+      }
+
+      /// Finds node_ again if the list replaced nodes or took a snapshot since the iterator
+      /// last looked at it. The end of the list has no node to find. Without the hint, GCC
+      /// moves the common case out of line and traversals take three jumps per element.
+      void sync() const {
+         if (epoch_ == ull_.epoch || node_ == nullptr) [[likely]] return;
+         size_t pos = start_ + i_;
+         Location l = ull_.find_at(pos);
+         node_ = l.u;
+         i_ = l.i;
+         start_ = pos - l.i;
+         epoch_ = ull_.epoch;
+         lookahead_ = Lookahead(node_, ull_.prefetch_distance, &Node::next);
+         land();
+      }
    };
 
-   Iterator begin() { return Iterator(head, 0, *this); }
-   Iterator end() { return Iterator(nullptr, 0, *this); }
+   using Iterator = BasicIterator<false>;
+   using ConstIterator = BasicIterator<true>;
+
+   Iterator begin() { return Iterator(head, 0, 0, *this); }
+   Iterator end() { return Iterator(nullptr, 0, length, *this); }
+   ConstIterator begin() const { return ConstIterator(head, 0, 0, *this); }
+   ConstIterator end() const { return ConstIterator(nullptr, 0, length, *this); }
+   ConstIterator cbegin() const { return begin(); }
+   ConstIterator cend() const { return end(); }
 
    private:
    /// Store the end of the list in head->prev.
    Node* head = nullptr;
 
+   /// Incremented whenever nodes are replaced, which tells iterators to find their node again,
+   /// and whenever a snapshot is taken, which tells them that their node may be shared again.
+   size_t epoch = 0;
+
+   /// Number of nodes in the list whose shared flag is set. Nodes are unshared before they
+   /// are removed, so only snapshot, unshare and relayout change it.
+   size_t shared_nodes = 0;
+
    /// Spreads the elements of the sequence u.next to v onto the sequence u.next to v.next,
    /// such that each node in the sequence u.next to v contains BLOCK_SIZE elements and
    /// v.next contains BLOCK_SIZE - 1 elements.
@@ -177,6 +426,37 @@ class ULL {
    /// u + BLOCK_SIZE - 2, such that each node in the sequence u to u + BLOCK_SIZE - 2 contains
    /// BLOCK_SIZE elements. The last node of the original sequence, which is now empty, is removed
    void gather(Node* u);
+
+   /// Returns a node that can be mutated in place of u. If u is shared with a snapshot,
+   /// it is replaced in the list by a private copy.
+   Node* unshare(Node* u);
+
+   /// Drops one reference to u and deletes it once no snapshot holds it anymore.
+   static void release(Node* u) {
+      if (u->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) destroy(u);
+   }
+
+   /// Deletes u and frees its slab once the slab is empty.
+   static void destroy(Node* u) {
+      Slab* slab = u->slab;
+      if (slab == nullptr) {
+         delete u;
+         return;
+      }
+
+      u->~Node();
+      if (slab->live.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+         std::allocator<Node>().deallocate(slab->nodes, slab->count);
+         delete slab;
+      }
+   }
+
+   /// Hints the CPU to load the cache line at p.
+   static void prefetch(const void* p) {
+#if defined(__GNUC__)
+      __builtin_prefetch(p);
+#endif
+   }
 };
 // Node - Begin
 // ------------------------------------------------------------------------
@@ -188,7 +468,7 @@ void ULL<V, BLOCK_SIZE>::Node::insert_at(size_t i, Args&&... args) {
    for (size_t idx = size; idx > i; --idx) {
       data[idx] = data[idx - 1];
    }
-   new (&data[i]) V(args...);
+   data[i] = V(std::forward<Args>(args)...);
    ++size;
 }
 // ------------------------------------------------------------------------
@@ -234,30 +514,33 @@ template <class V, size_t BLOCK_SIZE>
 ULL<V, BLOCK_SIZE>::~ULL() {
    Node* current = head;
    Node* next;
+   Lookahead lookahead(head, prefetch_distance, &Node::next);
    while (current) {
-      for (size_t i = 0; i < current->size; ++i) {
-         current->data[i].~V();
-      }
       next = current->next;
-      delete current;
+      release(current);
       current = next;
+      lookahead.step();
    }
 }
 // ------------------------------------------------------------------------
 template <class V, size_t BLOCK_SIZE>
-class ULL<V, BLOCK_SIZE>::Location ULL<V, BLOCK_SIZE>::find_at(int i) {
+class ULL<V, BLOCK_SIZE>::Location ULL<V, BLOCK_SIZE>::find_at(int i) const {
    Node* u = head;
    if (i < length / 2) { // Start at front of list and search forwards
+      Lookahead lookahead(u, prefetch_distance, &Node::next);
       while (i >= u->size) {
          i -= u->size;
          u = u->next;
+         lookahead.step();
       }
       return Location(u, i);
    } else { // Start at back of list and search backwards
+      Lookahead lookahead(u->prev, prefetch_distance, &Node::prev, head);
       int n = length;
       while (i < n) {
          u = u->prev;
          n -= u->size;
+         lookahead.step();
       }
       return Location(u, i - n);
    }
@@ -283,6 +566,8 @@ void ULL<V, BLOCK_SIZE>::insert_at(size_t i, Args&&... args) {
          end->prev = head->prev;
          head->prev = end;
          ++node_count;
+      } else {
+         end = unshare(end);
       }
       end->append(std::forward<Args>(args)...);
       ++length;
@@ -291,11 +576,17 @@ void ULL<V, BLOCK_SIZE>::insert_at(size_t i, Args&&... args) {
 
    // Inserting not at end of list
    Location l = find_at(i);
+   l.u = unshare(l.u);
+   // The shift cascades below walk back over the nodes this scan prefetches
    int r = 0;
    Node* u = l.u;
+   Lookahead lookahead(u, prefetch_distance, &Node::next);
    while (u != nullptr && r < BLOCK_SIZE && u->size == BLOCK_SIZE + 1) {
       u = u->next;
       ++r;
+      lookahead.step();
+      // The node ending the scan after BLOCK_SIZE full nodes is not touched by spread
+      if (u != nullptr && r < BLOCK_SIZE) u = unshare(u);
    }
 
    if (u == nullptr) { // case 2
@@ -352,12 +643,16 @@ void ULL<V, BLOCK_SIZE>::spread(Node* u, Node* v) {
 template <class V, size_t BLOCK_SIZE>
 void ULL<V, BLOCK_SIZE>::remove_at(size_t i) {
    Location l = find_at(i);
+   l.u = unshare(l.u);
 
+   // gather and the shift cascade below walk over the nodes this scan prefetches
    int r = 0;
    Node* u = l.u;
+   Lookahead lookahead(u, prefetch_distance, &Node::next);
    while (u != nullptr && r < BLOCK_SIZE && u->size == BLOCK_SIZE - 1) {
       u = u->next;
       ++r;
+      lookahead.step();
    }
 
    if (r == BLOCK_SIZE && u != nullptr) {
@@ -368,6 +663,7 @@ void ULL<V, BLOCK_SIZE>::remove_at(size_t i) {
    u->remove_at(l.i);
 
    while (u->next != nullptr && u->size < BLOCK_SIZE - 1) {
+      unshare(u->next);
       u->shift_l();
       u = u->next;
    }
@@ -378,7 +674,8 @@ void ULL<V, BLOCK_SIZE>::remove_at(size_t i) {
       if (u == head) {
          head = nullptr;
       }
-      delete u;
+      release(u);
+      --node_count;
    }
 
    --length;
@@ -387,6 +684,7 @@ void ULL<V, BLOCK_SIZE>::remove_at(size_t i) {
 template <class V, size_t BLOCK_SIZE>
 void ULL<V, BLOCK_SIZE>::gather(Node* u) {
    for (size_t i = 0; i < BLOCK_SIZE - 1; ++i) {
+      unshare(u->next);
       while (u->size < BLOCK_SIZE) {
          u->shift_l();
       }
@@ -395,12 +693,69 @@ void ULL<V, BLOCK_SIZE>::gather(Node* u) {
 
    u->prev->next = u->next;
    u->next->prev = u->prev;
-   delete u;
+   release(u);
+   --node_count;
+}
+// ------------------------------------------------------------------------
+template <class V, size_t BLOCK_SIZE>
+class ULL<V, BLOCK_SIZE>::Node* ULL<V, BLOCK_SIZE>::unshare(Node* u) {
+   if (!u->shared) return u;
+   --shared_nodes;
+   if (u->refs.load(std::memory_order_acquire) == 1) { // All snapshots holding u are gone
+      u->shared = false;
+      return u;
+   }
+
+   Node* copy = new Node;
+   std::copy(std::begin(u->data), std::begin(u->data) + u->size, std::begin(copy->data));
+   copy->size = u->size;
+   copy->next = u->next;
+   copy->prev = u->prev;
+
+   // Snapshots never follow next and prev, so the links of the shared node may go stale
+   if (u == head) {
+      head = copy;
+   } else {
+      copy->prev->next = copy;
+   }
+   if (copy->next != nullptr) {
+      copy->next->prev = copy;
+   } else {
+      head->prev = copy;
+   }
+
+   release(u);
+   ++epoch;
+   return copy;
+}
+// ------------------------------------------------------------------------
+template <class V, size_t BLOCK_SIZE>
+class ULL<V, BLOCK_SIZE>::Snapshot ULL<V, BLOCK_SIZE>::snapshot() {
+   Snapshot s;
+   s.nodes.reserve(node_count);
+   s.starts.reserve(node_count);
+
+   size_t start = 0;
+   for (Node* u = head; u != nullptr; u = u->next) {
+      u->refs.fetch_add(1, std::memory_order_relaxed);
+      if (!u->shared) {
+         u->shared = true;
+         ++shared_nodes;
+      }
+      s.nodes.push_back(u);
+      s.starts.push_back(start);
+      start += u->size;
+   }
+   s.length = length;
+   s.node_count = s.nodes.size();
+   ++epoch;
+   return s;
 }
 // ------------------------------------------------------------------------
 template <class V, size_t BLOCK_SIZE>
 void ULL<V, BLOCK_SIZE>::print_list() {
    Node* current = head;
+   Lookahead lookahead(head, prefetch_distance, &Node::next);
    while (current != nullptr) {
       std::cout << "[";
       for (size_t i = 0; i < current->size - 1; ++i) {
@@ -409,17 +764,117 @@ void ULL<V, BLOCK_SIZE>::print_list() {
       std::cout << current->data[current->size - 1] << "]"
                 << " -> " << std::endl;
       current = current->next;
+      lookahead.step();
    }
    std::cout << "null" << std::endl;
 }
 // ------------------------------------------------------------------------
 template <class V, size_t BLOCK_SIZE>
+void ULL<V, BLOCK_SIZE>::relayout() {
+   if (head == nullptr) return;
+
+   Slab* slab = new Slab;
+   slab->nodes = std::allocator<Node>().allocate(node_count);
+   slab->count = node_count;
+   slab->live.store(node_count, std::memory_order_relaxed);
+
+   Node* u = head;
+   Node* next;
+   for (size_t k = 0; k < node_count; ++k) {
+      Node* v = new (&slab->nodes[k]) Node;
+      v->slab = slab;
+      v->size = u->size;
+      if (u->refs.load(std::memory_order_acquire) == 1) {
+         std::move(std::begin(u->data), std::begin(u->data) + u->size, std::begin(v->data));
+      } else { // Still read by a snapshot
+         std::copy(std::begin(u->data), std::begin(u->data) + u->size, std::begin(v->data));
+      }
+      if (k > 0) {
+         v->prev = v - 1;
+         v->prev->next = v;
+      }
+
+      next = u->next;
+      release(u);
+      u = next;
+   }
+   assert(u == nullptr);
+
+   head = slab->nodes;
+   head->prev = slab->nodes + node_count - 1;
+   shared_nodes = 0;
+   ++epoch;
+}
+// ------------------------------------------------------------------------
+template <class V, size_t BLOCK_SIZE>
+bool ULL<V, BLOCK_SIZE>::check_invariants() {
+   if (head == nullptr) return length == 0 && node_count == 0;
+
+   size_t nodes = 0;
+   size_t elements = 0;
+   Node* last = nullptr;
+   for (Node* u = head; u != nullptr; u = u->next) {
+      if (u != head && u->prev != last) return false;
+      if (u->size == 0 || u->size > BLOCK_SIZE + 1) return false;
+      if (u->next != nullptr && u->size < BLOCK_SIZE - 1) return false;
+      ++nodes;
+      elements += u->size;
+      last = u;
+   }
+   return head->prev == last && elements == length && nodes == node_count;
+}
+// ------------------------------------------------------------------------
+template <class V, size_t BLOCK_SIZE>
 V& ULL<V, BLOCK_SIZE>::operator[](size_t i) {
    assert(i >= 0 && i < length);
 
+   auto l = find_at(i);
+   return unshare(l.u)->data[l.i];
+}
+// ------------------------------------------------------------------------
+template <class V, size_t BLOCK_SIZE>
+const V& ULL<V, BLOCK_SIZE>::operator[](size_t i) const {
+   assert(i >= 0 && i < length);
+
    auto l = find_at(i);
    return l.u->data[l.i];
 }
 // ------------------------------------------------------------------------
 // ULL - End
+// ------------------------------------------------------------------------
+// Snapshot - Begin
+template <class V, size_t BLOCK_SIZE>
+ULL<V, BLOCK_SIZE>::Snapshot::Snapshot(const Snapshot& other)
+   : nodes(other.nodes), starts(other.starts), length(other.length), node_count(other.node_count) {
+   for (Node* u : nodes) {
+      u->refs.fetch_add(1, std::memory_order_relaxed);
+   }
+}
+// ------------------------------------------------------------------------
+template <class V, size_t BLOCK_SIZE>
+ULL<V, BLOCK_SIZE>::Snapshot::Snapshot(Snapshot&& other) noexcept
+   : nodes(std::move(other.nodes)), starts(std::move(other.starts)), length(other.length), node_count(other.node_count) {
+   other.nodes.clear();
+   other.starts.clear();
+   other.length = 0;
+   other.node_count = 0;
+}
+// ------------------------------------------------------------------------
+template <class V, size_t BLOCK_SIZE>
+class ULL<V, BLOCK_SIZE>::Snapshot& ULL<V, BLOCK_SIZE>::Snapshot::operator=(Snapshot other) noexcept {
+   std::swap(nodes, other.nodes);
+   std::swap(starts, other.starts);
+   std::swap(length, other.length);
+   std::swap(node_count, other.node_count);
+   return *this;
+}
+// ------------------------------------------------------------------------
+template <class V, size_t BLOCK_SIZE>
+ULL<V, BLOCK_SIZE>::Snapshot::~Snapshot() {
+   for (Node* u : nodes) {
+      release(u);
+   }
+}
+// ------------------------------------------------------------------------
+// Snapshot - End
 #endif //UNROLLED_LINKED_LIST_ULL_HPP
@@ -0,0 +1,301 @@
+// ------------------------------------------------------------------------
+/*
+ * Randomized differential harness for ULL. Replays long edit sequences against ULL and
+ * std::vector for many BLOCK_SIZEs and element types, and checks contents, invariants,
+ * length and node_count after every step, as well as snapshots taken along the way.
+ *
+ * Built normally, it replays random sequences, reports the throughput of every
+ * configuration and compares scans with and without relayout() to a scan of std::vector:
+ *    differential [sequences] [operations] [seed] [scan length]
+ * Built with ULL_LIBFUZZER (requires Clang), it is a libFuzzer target that decodes every
+ * input into a sequence instead.
+ */
+// ------------------------------------------------------------------------
+#include "ULL.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+// ------------------------------------------------------------------------
+enum class OpKind : uint8_t { InsertAt,
+                              Append,
+                              Prepend,
+                              RemoveAt,
+                              PopFront,
+                              PopBack,
+                              Assign,
+                              Relayout,
+                              Snapshot,
+                              Count };
+// ------------------------------------------------------------------------
+struct Op {
+   OpKind kind;
+   uint32_t pos; // Taken modulo the valid range when the operation is applied
+};
+// ------------------------------------------------------------------------
+/// Decodes a fuzzer input, three bytes per operation.
+std::vector<Op> decode(const uint8_t* data, size_t size) {
+   std::vector<Op> ops;
+   for (size_t i = 0; i + 3 <= size; i += 3) {
+      auto kind = static_cast<OpKind>(data[i] % static_cast<uint8_t>(OpKind::Count));
+      ops.push_back({kind, static_cast<uint32_t>(data[i + 1] | data[i + 2] << 8)});
+   }
+   return ops;
+}
+// ------------------------------------------------------------------------
+/// Generates a sequence that alternates between random edits and runs of appends, prepends,
+/// hot-spot inserts and removals. The runs produce the long stretches of full or sparse nodes
+/// that drive insert_at and remove_at into spread and gather.
+std::vector<Op> generate(std::mt19937& gen, size_t count) {
+   std::vector<Op> ops;
+   ops.reserve(count);
+
+   while (ops.size() < count) {
+      size_t run = std::min<size_t>(count - ops.size(), 1 + gen() % 64);
+      uint32_t hot = gen();
+      // Grow during the first half of the sequence, shrink during the second half
+      bool grow = ops.size() < count / 2;
+
+      switch (gen() % 6) {
+         case 0:
+            for (size_t i = 0; i < run; ++i) ops.push_back({OpKind::Append, 0});
+            break;
+         case 1:
+            for (size_t i = 0; i < run; ++i) ops.push_back({OpKind::Prepend, 0});
+            break;
+         case 2:
+            for (size_t i = 0; i < run; ++i) ops.push_back({grow ? OpKind::InsertAt : OpKind::RemoveAt, hot});
+            break;
+         case 3:
+            for (size_t i = 0; i < run; ++i) ops.push_back({gen() % 2 ? OpKind::PopFront : OpKind::PopBack, 0});
+            break;
+         default:
+            for (size_t i = 0; i < run; ++i) {
+               uint32_t roll = gen() % 100;
+               OpKind kind = roll < 1 ? OpKind::Relayout : roll < 3 ? OpKind::Snapshot : roll < 10 ? OpKind::Assign : roll < (grow ? 65 : 45) ? OpKind::InsertAt : OpKind::RemoveAt;
+               ops.push_back({kind, static_cast<uint32_t>(gen())});
+            }
+            break;
+      }
+   }
+   return ops;
+}
+// ------------------------------------------------------------------------
+template <class V>
+V make_value(size_t n);
+// ------------------------------------------------------------------------
+template <>
+int make_value<int>(size_t n) { return static_cast<int>(n); }
+// ------------------------------------------------------------------------
+template <>
+std::string make_value<std::string>(size_t n) { return "longer-than-small-string-" + std::to_string(n); }
+// ------------------------------------------------------------------------
+/// Applies the n-th operation of a sequence to ull and, if given, to expected. Snapshots are
+/// left to the caller.
+template <class V, size_t BLOCK_SIZE>
+void apply(ULL<V, BLOCK_SIZE>& ull, std::vector<V>* expected, const Op& op, size_t n) {
+   size_t length = ull.length;
+   switch (op.kind) {
+      case OpKind::InsertAt: {
+         size_t pos = op.pos % (length + 1);
+         ull.insert_at(pos, make_value<V>(n));
+         if (expected) expected->insert(expected->begin() + pos, make_value<V>(n));
+         break;
+      }
+      case OpKind::Append:
+         ull.append(make_value<V>(n));
+         if (expected) expected->push_back(make_value<V>(n));
+         break;
+      case OpKind::Prepend:
+         ull.prepend(make_value<V>(n));
+         if (expected) expected->insert(expected->begin(), make_value<V>(n));
+         break;
+      case OpKind::RemoveAt: {
+         if (length == 0) break;
+         size_t pos = op.pos % length;
+         ull.remove_at(pos);
+         if (expected) expected->erase(expected->begin() + pos);
+         break;
+      }
+      case OpKind::PopFront:
+         if (length == 0) break;
+         ull.pop_front();
+         if (expected) expected->erase(expected->begin());
+         break;
+      case OpKind::PopBack:
+         if (length == 0) break;
+         ull.pop_back();
+         if (expected) expected->pop_back();
+         break;
+      case OpKind::Assign: {
+         if (length == 0) break;
+         size_t pos = op.pos % length;
+         ull[pos] = make_value<V>(n);
+         if (expected) (*expected)[pos] = make_value<V>(n);
+         break;
+      }
+      case OpKind::Relayout:
+         ull.relayout();
+         break;
+      default:
+         break;
+   }
+}
+// ------------------------------------------------------------------------
+void check(bool condition, const char* what, const char* config, size_t step) {
+   if (condition) return;
+   std::fprintf(stderr, "%s: %s check failed after operation %zu\n", config, what, step);
+   std::abort();
+}
+// ------------------------------------------------------------------------
+template <class Range, class V>
+bool equals(Range&& range, const std::vector<V>& expected) {
+   return std::equal(range.begin(), range.end(), expected.begin(), expected.end());
+}
+// ------------------------------------------------------------------------
+/// Replays ops against ULL and std::vector and aborts at the first difference.
+template <class V, size_t BLOCK_SIZE>
+void replay_checked(const char* config, const std::vector<Op>& ops) {
+   using Snapshot = typename ULL<V, BLOCK_SIZE>::Snapshot;
+
+   ULL<V, BLOCK_SIZE> ull;
+   std::vector<V> expected;
+   std::deque<std::pair<Snapshot, std::vector<V>>> snapshots;
+
+   for (size_t n = 0; n < ops.size(); ++n) {
+      if (ops[n].kind == OpKind::Snapshot) {
+         if (snapshots.size() == 4) {
+            check(equals(snapshots.front().first, snapshots.front().second), "snapshot", config, n);
+            snapshots.pop_front();
+         }
+         snapshots.emplace_back(ull.snapshot(), expected);
+      } else {
+         apply(ull, &expected, ops[n], n);
+      }
+
+      check(ull.length == expected.size(), "length", config, n);
+      check(ull.check_invariants(), "invariant", config, n);
+      check(equals(std::as_const(ull), expected), "content", config, n);
+   }
+
+   for (auto& [snapshot, contents] : snapshots) {
+      check(equals(snapshot, contents), "snapshot", config, ops.size());
+   }
+   check(equals(std::as_const(ull), expected), "content", config, ops.size());
+}
+// ------------------------------------------------------------------------
+/// Replays ops against ULL only and returns the elapsed seconds.
+template <class V, size_t BLOCK_SIZE>
+double replay_timed(const std::vector<Op>& ops) {
+   ULL<V, BLOCK_SIZE> ull;
+
+   auto start = std::chrono::steady_clock::now();
+   for (size_t n = 0; n < ops.size(); ++n) {
+      apply<V, BLOCK_SIZE>(ull, nullptr, ops[n], n);
+   }
+   return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+// ------------------------------------------------------------------------
+struct Config {
+   const char* name;
+   void (*checked)(const char*, const std::vector<Op>&);
+   double (*timed)(const std::vector<Op>&);
+};
+// ------------------------------------------------------------------------
+template <class V, size_t BLOCK_SIZE>
+constexpr Config config(const char* name) {
+   return {name, &replay_checked<V, BLOCK_SIZE>, &replay_timed<V, BLOCK_SIZE>};
+}
+// ------------------------------------------------------------------------
+const Config configs[] = {
+   config<int, 2>("ULL<int, 2>"),
+   config<int, 3>("ULL<int, 3>"),
+   config<int, 4>("ULL<int, 4>"),
+   config<int, 5>("ULL<int, 5>"),
+   config<int, 8>("ULL<int, 8>"),
+   config<int, 16>("ULL<int, 16>"),
+   config<int, 64>("ULL<int, 64>"),
+   config<std::string, 2>("ULL<std::string, 2>"),
+   config<std::string, 3>("ULL<std::string, 3>"),
+   config<std::string, 7>("ULL<std::string, 7>"),
+   config<std::string, 32>("ULL<std::string, 32>"),
+};
+// ------------------------------------------------------------------------
+/// Returns the nanoseconds per element of summing up range.
+template <class Range>
+double scan(const Range& range, size_t length) {
+   constexpr int rounds = 10;
+   volatile long sink = 0;
+
+   auto start = std::chrono::steady_clock::now();
+   for (int r = 0; r < rounds; ++r) {
+      long sum = 0;
+      for (int v : range) {
+         sum += v;
+      }
+      sink = sink + sum;
+   }
+   return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (rounds * length);
+}
+// ------------------------------------------------------------------------
+/// Reports the scan time of a list built by random insertions, whose nodes are scattered
+/// across the heap, before and after relayout().
+void report_scan(std::mt19937& gen, size_t length) {
+   ULL<int, 16> ull;
+   std::vector<std::unique_ptr<char[]>> clutter;
+   for (size_t n = 0; n < length; ++n) {
+      // Insert close to the end, which keeps building cheap but still allocates nodes out of list order
+      ull.insert_at(ull.length - gen() % std::min<size_t>(ull.length + 1, 4096), static_cast<int>(n));
+      // Interleave other allocations, as a long-running program would
+      if (n % 64 == 0) clutter.emplace_back(new char[gen() % 4096]);
+   }
+   std::vector<int> vector(ull.begin(), ull.end());
+
+   std::printf("scan std::vector<int>        %8.2f ns/element\n", scan(vector, length));
+   std::printf("scan ULL<int, 16>            %8.2f ns/element\n", scan(ull, length));
+   ull.relayout();
+   std::printf("scan ULL<int, 16> relayout() %8.2f ns/element\n", scan(ull, length));
+}
+// ------------------------------------------------------------------------
+#ifdef ULL_LIBFUZZER
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+   if (size == 0) return 0;
+
+   const Config& c = configs[data[0] % std::size(configs)];
+   c.checked(c.name, decode(data + 1, size - 1));
+   return 0;
+}
+#else
+int main(int argc, char** argv) {
+   size_t sequences = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10;
+   size_t operations = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 10'000;
+   unsigned seed = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : std::random_device()();
+   size_t scan_length = argc > 4 ? std::strtoull(argv[4], nullptr, 10) : 1 << 22;
+
+   std::printf("seed %u, %zu sequences of %zu operations\n", seed, sequences, operations);
+
+   for (const Config& c : configs) {
+      std::mt19937 gen(seed);
+      double seconds = 0;
+      for (size_t s = 0; s < sequences; ++s) {
+         auto ops = generate(gen, operations);
+         c.checked(c.name, ops);
+         seconds += c.timed(ops);
+      }
+      std::printf("%-24s %12.0f ops/s\n", c.name, static_cast<double>(sequences * operations) / seconds);
+   }
+
+   std::mt19937 gen(seed);
+   report_scan(gen, scan_length);
+   return 0;
+}
+#endif
+// ------------------------------------------------------------------------
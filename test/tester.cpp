@@ -1,5 +1,12 @@
+#include "ExternalULL.hpp"
+#include "SegmentedQueue.hpp"
+#include "TextBuffer.hpp"
 #include "ULL.hpp"
+#include <cstdio>
+#include <filesystem>
 #include <random>
+#include <sstream>
+#include <thread>
 #include <vector>
 #include <gtest/gtest.h>
 // ------------------------------------------------------------------------
@@ -342,3 +349,534 @@ TEST(UllTest, ManyInsertionsAndRemove) {
    EXPECT_TRUE(ull.is_empty());
 }
 // ------------------------------------------------------------------------
+TEST(UllTest, SnapshotIsolation) {
+   std::vector<int> expected;
+
+   ULL<int> ull;
+   for (int i = 0; i < 100; ++i) {
+      ull.append(i);
+      expected.push_back(i);
+   }
+
+   auto snapshot = ull.snapshot();
+
+   ull.insert_at(1, 42);
+   ull.insert_at(50, 43);
+   ull.append(44);
+   ull.remove_at(0);
+   ull.remove_at(70);
+   ull[10] = 45;
+   *ull.begin() = 46;
+
+   EXPECT_EQ(snapshot.length, expected.size());
+   for (int i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(*snapshot.get(i), expected[i]);
+   }
+
+   expected.insert(expected.begin() + 1, 42);
+   expected.insert(expected.begin() + 50, 43);
+   expected.push_back(44);
+   expected.erase(expected.begin());
+   expected.erase(expected.begin() + 70);
+   expected[10] = 45;
+   expected[0] = 46;
+
+   EXPECT_EQ(ull.length, expected.size());
+   for (int i = 0; i < expected.size(); ++i) {
+      EXPECT_EQ(*ull.get(i), expected[i]);
+   }
+}
+// ------------------------------------------------------------------------
+TEST(UllTest, SnapshotIteratorWrites) {
+   ULL<int> ull;
+   for (int i = 0; i < 10; ++i) {
+      ull.append(i);
+   }
+
+   // The iterator still points to the node that the assignment replaces
+   auto it = ull.begin();
+   auto snapshot = ull.snapshot();
+   ull[0] = 5;
+   *it = 7;
+   EXPECT_EQ(snapshot[0], 0);
+   EXPECT_EQ(ull[0], 7);
+
+   // Two iterators at the same node
+   auto a = ull.begin();
+   auto b = ull.begin();
+   ++b;
+   auto other = ull.snapshot();
+   *a = 100;
+   *b = 200;
+   EXPECT_EQ(other[0], 7);
+   EXPECT_EQ(other[1], 1);
+   EXPECT_EQ(ull[0], 100);
+   EXPECT_EQ(ull[1], 200);
+
+   // Iteration continues over the replaced nodes
+   int i = 0;
+   for (auto it = ull.begin(); it != ull.end(); ++it, ++i) {
+      if (i >= 2) EXPECT_EQ(*it, i);
+   }
+   EXPECT_EQ(i, 10);
+}
+// ------------------------------------------------------------------------
+TEST(UllTest, ConstReadsShareNodes) {
+   ULL<int> ull;
+   for (int i = 0; i < 100; ++i) {
+      ull.append(i);
+   }
+   auto snapshot = ull.snapshot();
+
+   // Reading through a const list does not copy the nodes the snapshot holds
+   const auto& view = ull;
+   int i = 0;
+   for (auto it = view.begin(); it != view.end(); ++it, ++i) {
+      EXPECT_EQ(&*it, &snapshot[i]);
+   }
+   EXPECT_EQ(i, 100);
+   EXPECT_EQ(view.get(50), &snapshot[50]);
+   EXPECT_EQ(&view[99], &snapshot[99]);
+
+   // A const iterator finds its node again after an assignment replaced it
+   auto it = ull.cbegin();
+   ull[0] = 42;
+   EXPECT_EQ(*it, 42);
+   EXPECT_EQ(snapshot[0], 0);
+}
+// ------------------------------------------------------------------------
+TEST(UllTest, SnapshotOutlivesList) {
+   ULL<int, 4>::Snapshot snapshot;
+   {
+      ULL<int, 4> ull;
+      for (int i = 0; i < 30; ++i) {
+         ull.append(i);
+      }
+      snapshot = ull.snapshot();
+      while (!ull.is_empty()) {
+         ull.pop_front();
+      }
+   }
+
+   auto copy = snapshot;
+
+   int i = 0;
+   for (auto v : copy) {
+      EXPECT_EQ(v, i);
+      EXPECT_EQ(snapshot[i], i);
+      ++i;
+   }
+   EXPECT_EQ(i, 30);
+   EXPECT_EQ(snapshot.get(30), nullptr);
+}
+// ------------------------------------------------------------------------
+TEST(UllTest, ManySnapshots) {
+   ULL<int> ull;
+   std::vector<std::vector<int>> expected;
+   std::vector<ULL<int>::Snapshot> snapshots;
+   std::vector<int> current;
+
+   std::mt19937 gen(42);
+   for (int i = 0; i < 2'000; ++i) {
+      if (current.empty() || gen() % 3 != 0) {
+         std::uniform_int_distribution<> dist(0, current.size());
+         int pos = dist(gen);
+         ull.insert_at(pos, i);
+         current.insert(current.begin() + pos, i);
+      } else {
+         std::uniform_int_distribution<> dist(0, current.size() - 1);
+         int pos = dist(gen);
+         ull.remove_at(pos);
+         current.erase(current.begin() + pos);
+      }
+      if (i % 100 == 0) {
+         snapshots.push_back(ull.snapshot());
+         expected.push_back(current);
+      }
+   }
+
+   for (size_t s = 0; s < snapshots.size(); ++s) {
+      std::vector<int> actual(snapshots[s].begin(), snapshots[s].end());
+      EXPECT_EQ(actual, expected[s]);
+   }
+}
+// ------------------------------------------------------------------------
+TEST(UllTest, Relayout) {
+   ULL<int, 4> ull;
+   std::vector<int> expected;
+
+   std::mt19937 gen(42);
+   for (int i = 0; i < 1'000; ++i) {
+      std::uniform_int_distribution<> dist(0, expected.size());
+      int pos = dist(gen);
+      ull.insert_at(pos, i);
+      expected.insert(expected.begin() + pos, i);
+   }
+
+   auto snapshot = ull.snapshot();
+   ull.relayout();
+   ASSERT_TRUE(ull.check_invariants());
+
+   // Edit the relaid list, including removing nodes from the slab
+   for (int i = 0; i < 600; ++i) {
+      std::uniform_int_distribution<> dist(0, expected.size() - 1);
+      int pos = dist(gen);
+      ull.remove_at(pos);
+      expected.erase(expected.begin() + pos);
+   }
+   ull.insert_at(10, 42);
+   expected.insert(expected.begin() + 10, 42);
+
+   ASSERT_TRUE(ull.check_invariants());
+   EXPECT_TRUE(std::equal(ull.begin(), ull.end(), expected.begin(), expected.end()));
+   EXPECT_EQ(snapshot.length, 1'000);
+
+   ull.relayout();
+   ASSERT_TRUE(ull.check_invariants());
+   EXPECT_TRUE(std::equal(ull.begin(), ull.end(), expected.begin(), expected.end()));
+}
+// ------------------------------------------------------------------------
+TEST(UllTest, PrefetchDistance) {
+   std::vector<int> expected;
+   for (int i = 0; i < 100; ++i) {
+      expected.push_back(i);
+   }
+
+   for (size_t distance : {0, 1, 3, 1'000}) {
+      ULL<int> ull;
+      ull.prefetch_distance = distance;
+      for (int i = 0; i < 100; ++i) {
+         ull.append(i);
+      }
+      ull.insert_at(0, -1);
+      ull.remove_at(0);
+
+      EXPECT_TRUE(std::equal(ull.begin(), ull.end(), expected.begin(), expected.end()));
+      for (int i = 0; i < expected.size(); ++i) {
+         EXPECT_EQ(ull[i], expected[i]);
+      }
+   }
+}
+// ------------------------------------------------------------------------
+TEST(ExternalUllTest, InsertionAndRemove) {
+   auto path = std::filesystem::temp_directory_path() / "ull_external_insertion_and_remove.bin";
+   std::vector<int> expected;
+   {
+      // BLOCK_SIZE 15 and a cache of four nodes, so that the cascades constantly evict nodes
+      ExternalULL<int, 64> ull(path, 4);
+      ASSERT_EQ(ull.get_block_size(), 15);
+
+      std::mt19937 gen(42);
+      for (int i = 0; i < 5'000; ++i) {
+         if (expected.empty() || gen() % 3 != 0) {
+            std::uniform_int_distribution<> dist(0, expected.size());
+            int pos = dist(gen);
+            ull.insert_at(pos, i);
+            expected.insert(expected.begin() + pos, i);
+         } else {
+            std::uniform_int_distribution<> dist(0, expected.size() - 1);
+            int pos = dist(gen);
+            ull.remove_at(pos);
+            expected.erase(expected.begin() + pos);
+         }
+      }
+
+      EXPECT_EQ(ull.length, expected.size());
+      for (int i = 0; i < expected.size(); ++i) {
+         EXPECT_EQ(*ull.get(i), expected[i]);
+      }
+      EXPECT_GT(ull.total_io.writes, 0);
+      EXPECT_GT(ull.total_io.reads, 0);
+
+      while (!ull.is_empty()) {
+         ull.pop_back();
+      }
+      EXPECT_EQ(ull.node_count, 0);
+   }
+   std::filesystem::remove(path);
+}
+// ------------------------------------------------------------------------
+TEST(ExternalUllTest, IoStats) {
+   auto path = std::filesystem::temp_directory_path() / "ull_external_io_stats.bin";
+   {
+      ExternalULL<int> ull(path, 2);
+      ASSERT_EQ(ull.get_block_size(), 1023);
+
+      for (int i = 0; i < 10 * 1024; ++i) {
+         ull.append(i);
+      }
+      ull.flush();
+      EXPECT_EQ(ull.last_io.writes, 2);
+
+      EXPECT_EQ(*ull.get(0), 0);
+      EXPECT_EQ(ull.last_io.misses, 1);
+      EXPECT_EQ(ull.last_io.reads, 1);
+
+      EXPECT_EQ(*ull.get(1), 1);
+      EXPECT_EQ(ull.last_io.hits, 1);
+      EXPECT_EQ(ull.last_io.reads, 0);
+
+      ull.set(1, 42);
+      EXPECT_EQ(*ull.get(1), 42);
+      EXPECT_EQ(ull.get(-1), std::nullopt);
+      EXPECT_EQ(ull.get(10 * 1024), std::nullopt);
+   }
+   std::filesystem::remove(path);
+}
+// ------------------------------------------------------------------------
+TEST(ExternalUllTest, CacheStaysBounded) {
+   auto path = std::filesystem::temp_directory_path() / "ull_external_cache_stays_bounded.bin";
+   {
+      ExternalULL<int, 64> ull(path, 2);
+      std::vector<int> expected;
+      for (int i = 0; i < 200 * 16; ++i) {
+         ull.append(i);
+         expected.push_back(i);
+      }
+      ASSERT_EQ(ull.node_count, 200);
+
+      // Cascades through full and sparse nodes fault in far more nodes than fit into the cache
+      ull.insert_at(0, -1);
+      expected.insert(expected.begin(), -1);
+      for (int i = 0; i < 100; ++i) {
+         ull.insert_at(1'000, i);
+         expected.insert(expected.begin() + 1'000, i);
+      }
+      for (int i = 0; i < 2'000; ++i) {
+         ull.remove_at(500);
+         expected.erase(expected.begin() + 500);
+      }
+
+      EXPECT_EQ(ull.peak_cached_nodes, 2);
+      ASSERT_EQ(ull.length, expected.size());
+      for (int i = 0; i < expected.size(); ++i) {
+         EXPECT_EQ(*ull.get(i), expected[i]);
+      }
+   }
+   EXPECT_THROW((ExternalULL<int, 64>(path, 1)), std::invalid_argument);
+   EXPECT_THROW((ExternalULL<int, 64>(path, 0)), std::invalid_argument);
+   std::filesystem::remove(path);
+}
+// ------------------------------------------------------------------------
+TEST(ExternalUllTest, LargePages) {
+   auto path = std::filesystem::temp_directory_path() / "ull_external_large_pages.bin";
+   {
+      ExternalULL<int64_t, 64 * 1024> ull(path, 8);
+      ASSERT_EQ(ull.get_block_size(), 8191);
+
+      for (int64_t i = 0; i < 50'000; ++i) {
+         ull.append(i);
+      }
+      ull.insert_at(20'000, -1);
+      ull.remove_at(0);
+
+      EXPECT_EQ(ull.length, 50'000);
+      EXPECT_EQ(*ull.get(19'999), -1);
+      for (int64_t i = 0; i < 19'999; i += 997) {
+         EXPECT_EQ(*ull.get(i), i + 1);
+      }
+      for (int64_t i = 20'000; i < 50'000; i += 997) {
+         EXPECT_EQ(*ull.get(i), i);
+      }
+   }
+   std::filesystem::remove(path);
+}
+// ------------------------------------------------------------------------
+TEST(SegmentedQueueTest, Fifo) {
+   SegmentedQueue<int, 3> queue;
+   int value;
+
+   EXPECT_FALSE(queue.try_dequeue(value));
+
+   // Alternate between filling and draining, so that drained nodes get recycled
+   int next_in = 0;
+   int next_out = 0;
+   for (int round = 0; round < 100; ++round) {
+      for (int i = 0; i < round % 17; ++i) {
+         queue.enqueue(next_in++);
+      }
+      for (int i = 0; i < round % 13; ++i) {
+         if (!queue.try_dequeue(value)) break;
+         EXPECT_EQ(value, next_out++);
+      }
+   }
+   while (queue.try_dequeue(value)) {
+      EXPECT_EQ(value, next_out++);
+   }
+
+   EXPECT_EQ(next_out, next_in);
+}
+// ------------------------------------------------------------------------
+TEST(SegmentedQueueTest, SingleProducer) {
+   constexpr int count = 200'000;
+   SegmentedQueue<int> queue;
+
+   std::thread producer([&] {
+      for (int i = 0; i < count; ++i) {
+         queue.enqueue(i);
+      }
+   });
+
+   int expected = 0;
+   int value;
+   while (expected < count) {
+      if (queue.try_dequeue(value)) {
+         ASSERT_EQ(value, expected);
+         ++expected;
+      }
+   }
+   producer.join();
+
+   EXPECT_FALSE(queue.try_dequeue(value));
+}
+// ------------------------------------------------------------------------
+TEST(SegmentedQueueTest, MultiProducer) {
+   constexpr int producers = 4;
+   constexpr int count = 50'000;
+   SegmentedQueue<std::pair<int, int>, 15, Producers::Multi> queue;
+
+   std::vector<std::thread> threads;
+   for (int p = 0; p < producers; ++p) {
+      threads.emplace_back([&queue, p] {
+         for (int i = 0; i < count; ++i) {
+            queue.enqueue(p, i);
+         }
+      });
+   }
+
+   // Each producer's values have to arrive in order
+   std::vector<int> expected(producers, 0);
+   std::pair<int, int> value;
+   for (int received = 0; received < producers * count;) {
+      if (queue.try_dequeue(value)) {
+         ASSERT_EQ(value.second, expected[value.first]);
+         ++expected[value.first];
+         ++received;
+      }
+   }
+   for (auto& thread : threads) {
+      thread.join();
+   }
+
+   EXPECT_FALSE(queue.try_dequeue(value));
+}
+// ------------------------------------------------------------------------
+TEST(SegmentedQueueTest, RecyclesUnderLoad) {
+   constexpr int producers = 4;
+   constexpr int count = 50'000;
+   SegmentedQueue<int, 7, Producers::Multi> queue;
+
+   std::vector<std::thread> threads;
+   for (int p = 0; p < producers; ++p) {
+      threads.emplace_back([&queue] {
+         for (int i = 0; i < count; ++i) {
+            queue.enqueue(i);
+         }
+      });
+   }
+
+   // Every producer holds on to at most one node, so drained nodes may not pile up while
+   // the producers keep running
+   size_t max_pending = 0;
+   int value;
+   for (int received = 0; received < producers * count;) {
+      if (queue.try_dequeue(value)) {
+         ++received;
+         max_pending = std::max(max_pending, queue.pending_nodes());
+      }
+   }
+   for (auto& thread : threads) {
+      thread.join();
+   }
+
+   EXPECT_LE(max_pending, producers);
+   EXPECT_FALSE(queue.try_dequeue(value));
+}
+// ------------------------------------------------------------------------
+TEST(TextBufferTest, InsertAndErase) {
+   TextBuffer<16> text;
+   std::string expected;
+
+   std::mt19937 gen(42);
+   for (int i = 0; i < 5'000; ++i) {
+      if (expected.empty() || gen() % 2 == 0) {
+         std::string insertion(gen() % 40, 'a' + i % 26);
+         for (auto& c : insertion) {
+            if (gen() % 8 == 0) c = '\n';
+         }
+         size_t pos = gen() % (expected.size() + 1);
+         text.insert(pos, insertion);
+         expected.insert(pos, insertion);
+      } else {
+         size_t pos = gen() % expected.size();
+         size_t len = gen() % 40;
+         text.erase(pos, len);
+         expected.erase(pos, len);
+      }
+
+      ASSERT_EQ(text.length, expected.size());
+      ASSERT_EQ(text.line_count(), std::count(expected.begin(), expected.end(), '\n') + 1);
+      ASSERT_TRUE(text.check_invariants());
+   }
+
+   EXPECT_EQ(text.substr(0, text.length), expected);
+   EXPECT_EQ(text.substr(10, 100), expected.substr(10, 100));
+   EXPECT_EQ(text[17], expected[17]);
+}
+// ------------------------------------------------------------------------
+TEST(TextBufferTest, EraseMergesUntilHalfFull) {
+   TextBuffer<16> text;
+   text.insert(0, std::string(48, 'x'));
+   ASSERT_EQ(text.node_count, 3);
+
+   // Leaves 1 byte in the first and 2 bytes in the second node, which merge into a node
+   // that is still less than half full
+   text.erase(1, 29);
+   EXPECT_TRUE(text.check_invariants());
+   EXPECT_EQ(text.length, 19);
+   EXPECT_EQ(text.substr(0, 19), std::string(19, 'x'));
+}
+// ------------------------------------------------------------------------
+TEST(TextBufferTest, LineColumn) {
+   std::string expected = "first\nsecond line\n\nlast";
+   TextBuffer<4> text(expected);
+
+   EXPECT_EQ(text.line_count(), 4);
+
+   for (size_t pos = 0; pos <= expected.size(); ++pos) {
+      size_t line = std::count(expected.begin(), expected.begin() + pos, '\n');
+      size_t start = expected.rfind('\n', pos == 0 ? 0 : pos - 1);
+      start = (start == std::string::npos || start >= pos) ? 0 : start + 1;
+
+      auto lc = text.line_column(pos);
+      EXPECT_EQ(lc.line, line);
+      EXPECT_EQ(lc.column, pos - start);
+      EXPECT_EQ(text.position(lc.line, lc.column), pos);
+   }
+}
+// ------------------------------------------------------------------------
+TEST(TextBufferTest, WriteTo) {
+   std::string expected;
+   for (int i = 0; i < 10'000; ++i) {
+      expected += "line " + std::to_string(i) + "\n";
+   }
+
+   TextBuffer<> text;
+   for (size_t pos = 0; pos < expected.size(); pos += 1'000) {
+      text.insert(pos, std::string_view(expected).substr(pos, 1'000));
+   }
+
+   std::ostringstream os;
+   text.write_to(os);
+   EXPECT_EQ(os.str(), expected);
+
+   std::FILE* file = std::tmpfile();
+   ASSERT_NE(file, nullptr);
+   ASSERT_TRUE(text.write_to(fileno(file)));
+   std::rewind(file);
+   std::string actual(expected.size(), '\0');
+   EXPECT_EQ(std::fread(actual.data(), 1, actual.size(), file), expected.size());
+   EXPECT_EQ(actual, expected);
+   std::fclose(file);
+}
+// ------------------------------------------------------------------------